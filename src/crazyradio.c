@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <libusb.h>
 
@@ -45,7 +46,17 @@
 #define CR_ERR_BADMODE      7
 #define CR_ERR_NODEVICE     8
 #define CR_ERR_NOTENOUGH    9
-#define CR_ERR_LAST         10
+#define CR_ERR_BADPRIO      10
+#define CR_ERR_BADLEN       11
+#define CR_ERR_QUEUEFULL    12
+#define CR_ERR_BADCRTP      13
+#define CR_ERR_NOACK        14
+#define CR_ERR_CRTPTIMEOUT  15
+#define CR_ERR_BADLOGBLOCK  16
+#define CR_ERR_BADLOGPERIOD 17
+#define CR_ERR_TARGET       18
+#define CR_ERR_NOTXQ        19
+#define CR_ERR_LAST         20
 
 
 static const char *errtext[] = {
@@ -54,11 +65,21 @@ static const char *errtext[] = {
     "Invalid data rate (must be 0-2)",
     "Invalid power level (must be 0-3)",
     "Invalid retry count (must be 0-15)",
-    "Invalid retry delay time (must be =< 4000)",
+    "Invalid retry delay time (must be 250-4000)",
     "invalid retry packet size (must be 0-32)",
     "Invalid mode (must be 0 or 2)",
     "No crazyradio VID/PID found",
-    "Cannot find specific radio device"
+    "Cannot find specific radio device",
+    "Invalid tx queue priority",
+    "Invalid packet length (must be 1-32)",
+    "TX queue full for this priority",
+    "Invalid CRTP packet (port 0-15, channel 0-3, 0-30 bytes)",
+    "No ack received from target",
+    "Timed out waiting for CRTP response",
+    "Invalid log block (1-26 bytes of variables)",
+    "Invalid log period (must be 10-2550ms)",
+    "Target rejected request",
+    "No tx queue attached to CRTP link"
 };
 
 static libusb_context *context = NULL;
@@ -69,6 +90,7 @@ static int config_timeout = 1000;
 
 /* Forwards */
 static void cradio_log(int level, char *format, ...);
+static void crtp_detach_txq(cradio_crtp_link_t *pl);
 
 
 int cradio_init(void) {
@@ -277,6 +299,19 @@ static int cradio_send_config(cradio_device_t *prd, uint8_t request,
     return 0;
 }
 
+/* Send a raw config request
+ *
+ * No range checking or conversion is done on value; it goes to the
+ * dongle as-is.  This is for callers that have already validated
+ * the setting (the C++ wrapper checks at compile time).  For ARD,
+ * value is the register value: retries every (value + 1) * 250uS,
+ * or 0x80 | bytes for an ack payload length.
+ */
+int cradio_set_config(cradio_device_t *prd, uint8_t request, uint16_t value) {
+    CRDEBUG("Setting config %02x to %02x", request, value);
+    return cradio_send_config(prd, request, value, 0, NULL, 0);
+}
+
 
 /* Set the radio channel on the nRF radio.
  *
@@ -363,16 +398,16 @@ int cradio_set_arc(cradio_device_t *prd, uint16_t arc) {
 /* Set the ACK retry delay
  *
  * Ack retry delay is from 250uS to 4000uS, in 250uS
- * increments.  Values greater than 4000uS will be
- * ignored
+ * increments (rounded down).  Values outside that range
+ * are rejected.
  */
 int cradio_set_ard_time(cradio_device_t *prd, int us) {
     uint16_t ard_time;
 
-    if(us > 4000)
+    if((us < 250) || (us > 4000))
         return set_cradio_error(CR_ERR_BADARDTIME);
 
-    ard_time = (us / 150) - 1;
+    ard_time = (us / 250) - 1;
 
     CRDEBUG("Setting ard time %02x", ard_time);
     return cradio_send_config(prd, CONF_SET_RADIO_ARD, ard_time, 0, NULL, 0);
@@ -462,3 +497,1165 @@ int cradio_close(cradio_device_t *prd) {
 
     return 0;
 }
+
+
+/* Priority/deadline TX queue
+ *
+ * Packets are queued per priority class and written out by
+ * cradio_txq_dispatch in strict priority order, so a control packet
+ * never waits behind a burst of bulk traffic.  To keep lower classes
+ * from starving, a class that has been passed over more than
+ * starvation_limit times in a row gets the next slot.
+ *
+ * Packets may carry a deadline; a packet that is still queued when
+ * its deadline passes is dropped (and handed to the expired callback,
+ * if set) instead of being sent late.
+ */
+
+#define TXQ_DEFAULT_STARVATION_LIMIT 8
+
+/* status byte the dongle returns on 0x81 after a PTX write */
+#define ACK_STATUS_ACK           0x01
+
+typedef struct txq_entry_t {
+    uint64_t enqueued_us;
+    uint64_t deadline_us;   /* 0 for no deadline */
+    int len;
+    unsigned char buffer[TXQ_MAX_PACKET];
+} txq_entry_t;
+
+typedef struct txq_class_t {
+    txq_entry_t *entries;
+    int head;
+    int count;
+    int skipped;
+    cradio_txq_stats_t stats;
+} txq_class_t;
+
+struct cradio_txq_t {
+    cradio_device_t *prd;
+    int depth;
+    int starvation_limit;
+    cradio_txq_expired_cb expired_cb;
+    void *expired_arg;
+    cradio_txq_ack_cb ack_cb;
+    void *ack_arg;
+    cradio_crtp_link_t *link;   /* attached CRTP link, if any */
+    txq_class_t classes[TXQ_PRIO_COUNT];
+};
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Create a tx queue for a device, holding up to depth packets
+ * per priority class
+ */
+cradio_txq_t *cradio_txq_new(cradio_device_t *prd, int depth) {
+    cradio_txq_t *pq;
+
+    if(depth < 1)
+        depth = 1;
+
+    pq = (cradio_txq_t *)malloc(sizeof(cradio_txq_t));
+    if(!pq)
+        cradio_exit("malloc error");
+    memset(pq, 0, sizeof(cradio_txq_t));
+
+    pq->prd = prd;
+    pq->depth = depth;
+    pq->starvation_limit = TXQ_DEFAULT_STARVATION_LIMIT;
+
+    for(int prio = 0; prio < TXQ_PRIO_COUNT; prio++) {
+        pq->classes[prio].entries =
+            (txq_entry_t *)malloc(depth * sizeof(txq_entry_t));
+        if(!pq->classes[prio].entries)
+            cradio_exit("malloc error");
+    }
+
+    CRDEBUG("Created tx queue with depth %d", depth);
+    return pq;
+}
+
+/* Free a queue, detaching it from any CRTP link it's attached to */
+void cradio_txq_free(cradio_txq_t *pq) {
+    if(pq) {
+        if(pq->link)
+            crtp_detach_txq(pq->link);
+        for(int prio = 0; prio < TXQ_PRIO_COUNT; prio++)
+            free(pq->classes[prio].entries);
+        free(pq);
+    }
+}
+
+/* Set how many consecutive dispatches a pending class can be
+ * passed over before it is served ahead of higher classes.
+ * 0 disables starvation protection (pure strict priority).
+ */
+void cradio_txq_set_starvation_limit(cradio_txq_t *pq, int limit) {
+    pq->starvation_limit = limit < 0 ? 0 : limit;
+}
+
+void cradio_txq_set_expired_callback(cradio_txq_t *pq,
+                                     cradio_txq_expired_cb cb, void *arg) {
+    pq->expired_cb = cb;
+    pq->expired_arg = arg;
+}
+
+/* Set a callback for the ack payload of each packet the target acks.
+ * A CRTP link attached with cradio_crtp_set_txq uses this to collect
+ * downlink data.
+ */
+void cradio_txq_set_ack_callback(cradio_txq_t *pq, cradio_txq_ack_cb cb,
+                                 void *arg) {
+    pq->ack_cb = cb;
+    pq->ack_arg = arg;
+}
+
+/* Queue a packet
+ *
+ * deadline_ms is relative to now; 0 means the packet never expires.
+ */
+int cradio_txq_push(cradio_txq_t *pq, int prio, unsigned char *buffer,
+                    int len, int deadline_ms) {
+    txq_class_t *pc;
+    txq_entry_t *pe;
+
+    if((prio < 0) || (prio >= TXQ_PRIO_COUNT))
+        return set_cradio_error(CR_ERR_BADPRIO);
+
+    if((len < 1) || (len > TXQ_MAX_PACKET))
+        return set_cradio_error(CR_ERR_BADLEN);
+
+    pc = &pq->classes[prio];
+
+    if(pc->count == pq->depth) {
+        pc->stats.rejected++;
+        return set_cradio_error(CR_ERR_QUEUEFULL);
+    }
+
+    pe = &pc->entries[(pc->head + pc->count) % pq->depth];
+    pe->enqueued_us = now_us();
+    pe->deadline_us = deadline_ms > 0 ?
+        pe->enqueued_us + (uint64_t)deadline_ms * 1000 : 0;
+    pe->len = len;
+    memcpy(pe->buffer, buffer, len);
+
+    pc->count++;
+    pc->stats.queued++;
+    if(pc->count > pc->stats.max_depth)
+        pc->stats.max_depth = pc->count;
+
+    return 0;
+}
+
+/* drop every packet in a class whose deadline has passed,
+ * keeping the rest in order.
+ *
+ * Each expired packet is removed from the ring before its callback
+ * runs, so the callback is free to push to the queue again.
+ */
+static void txq_expire(cradio_txq_t *pq, int prio, uint64_t now) {
+    txq_class_t *pc = &pq->classes[prio];
+    txq_entry_t expired;
+    int idx = 0;
+
+    while(idx < pc->count) {
+        txq_entry_t *pe = &pc->entries[(pc->head + idx) % pq->depth];
+
+        if(!pe->deadline_us || (pe->deadline_us > now)) {
+            idx++;
+            continue;
+        }
+
+        expired = *pe;
+        for(int move = idx; move < pc->count - 1; move++)
+            pc->entries[(pc->head + move) % pq->depth] =
+                pc->entries[(pc->head + move + 1) % pq->depth];
+        pc->count--;
+
+        CRDEBUG("Dropping expired packet (prio %d)", prio);
+        pc->stats.expired++;
+        if(pq->expired_cb)
+            pq->expired_cb(prio, expired.buffer, expired.len,
+                           pq->expired_arg);
+    }
+}
+
+/* pick the class to serve next: the highest starved class if any,
+ * otherwise the highest non-empty class.
+ */
+static int txq_select(cradio_txq_t *pq) {
+    int selected = -1;
+
+    for(int prio = 0; prio < TXQ_PRIO_COUNT; prio++) {
+        txq_class_t *pc = &pq->classes[prio];
+
+        if(!pc->count)
+            continue;
+
+        if(selected == -1)
+            selected = prio;
+
+        if(pq->starvation_limit &&
+           (pc->skipped >= pq->starvation_limit)) {
+            selected = prio;
+            break;
+        }
+    }
+
+    /* an empty class (even one emptied by expiry) starts over */
+    for(int prio = 0; prio < TXQ_PRIO_COUNT; prio++) {
+        if((prio == selected) || !pq->classes[prio].count)
+            pq->classes[prio].skipped = 0;
+        else
+            pq->classes[prio].skipped++;
+    }
+
+    return selected;
+}
+
+/* Write the next packet from the queue
+ *
+ * The packet counts as sent once the target acks it (auto-ack must
+ * be enabled), and latency is measured up to that ack.
+ *
+ * Returns 1 if a packet was sent, 0 if nothing was pending, or -1
+ * on a write error or missing ack (the packet is dropped and counted
+ * as failed).
+ */
+int cradio_txq_dispatch(cradio_txq_t *pq, int timeout) {
+    txq_class_t *pc;
+    txq_entry_t entry;
+    unsigned char ack[64];
+    uint64_t now;
+    uint32_t latency;
+    int prio;
+    int rc;
+
+    now = now_us();
+    for(prio = 0; prio < TXQ_PRIO_COUNT; prio++)
+        txq_expire(pq, prio, now);
+
+    prio = txq_select(pq);
+    if(prio == -1)
+        return 0;
+
+    pc = &pq->classes[prio];
+    entry = pc->entries[pc->head];
+    pc->head = (pc->head + 1) % pq->depth;
+    pc->count--;
+
+    rc = cradio_write_packet(pq->prd, entry.buffer, entry.len, timeout);
+    if(rc != entry.len) {
+        pc->stats.failed++;
+        if(rc >= 0)
+            set_usb_error(LIBUSB_ERROR_TIMEOUT);
+        return -1;
+    }
+
+    rc = cradio_read_packet(pq->prd, ack, sizeof(ack), timeout);
+    if(rc < 0) {
+        pc->stats.failed++;
+        return -1;
+    }
+
+    if((rc < 1) || !(ack[0] & ACK_STATUS_ACK)) {
+        pc->stats.failed++;
+        return set_cradio_error(CR_ERR_NOACK);
+    }
+
+    latency = (uint32_t)(now_us() - entry.enqueued_us);
+    pc->stats.sent++;
+    pc->stats.latency_total_us += latency;
+    if(latency > pc->stats.latency_max_us)
+        pc->stats.latency_max_us = latency;
+
+    if(pq->ack_cb)
+        pq->ack_cb(prio, ack + 1, rc - 1, pq->ack_arg);
+
+    return 1;
+}
+
+/* Dispatch until the queue is empty, returning the number of
+ * packets sent, or -1 on the first write error
+ */
+int cradio_txq_flush(cradio_txq_t *pq, int timeout) {
+    int sent = 0;
+    int rc;
+
+    while((rc = cradio_txq_dispatch(pq, timeout)) > 0)
+        sent++;
+
+    return rc < 0 ? -1 : sent;
+}
+
+/* Total packets queued across all classes */
+int cradio_txq_pending(cradio_txq_t *pq) {
+    int pending = 0;
+
+    for(int prio = 0; prio < TXQ_PRIO_COUNT; prio++)
+        pending += pq->classes[prio].count;
+
+    return pending;
+}
+
+int cradio_txq_get_stats(cradio_txq_t *pq, int prio,
+                         cradio_txq_stats_t *stats) {
+    if((prio < 0) || (prio >= TXQ_PRIO_COUNT))
+        return set_cradio_error(CR_ERR_BADPRIO);
+
+    *stats = pq->classes[prio].stats;
+    stats->depth = pq->classes[prio].count;
+    return 0;
+}
+
+void cradio_txq_reset_stats(cradio_txq_t *pq) {
+    for(int prio = 0; prio < TXQ_PRIO_COUNT; prio++)
+        memset(&pq->classes[prio].stats, 0, sizeof(cradio_txq_stats_t));
+}
+
+
+/* CRTP link
+ *
+ * CRTP packets are a one byte header (port in the high nibble,
+ * channel in the low two bits) followed by up to 30 bytes of data.
+ * The target has no way to send on its own: downlink data comes back
+ * as the ack payload of whatever the host sends, so every uplink
+ * packet doubles as a poll, and when there's nothing to send a null
+ * packet (header 0xFF) is used to pull data down.
+ *
+ * Downlink packets are queued on the link and handed out by
+ * cradio_crtp_receive.  The null packet rate adapts to the traffic:
+ * as long as acks carry data the link keeps polling back to back, and
+ * after a run of empty acks the interval backs off exponentially
+ * between poll_min and poll_max.
+ *
+ * A link can share its device with a priority tx queue (see
+ * cradio_crtp_set_txq).  Packets queued with cradio_crtp_queue go out
+ * in priority order, their ack payloads land on the link, and
+ * whenever the link would poll it sends the next queued packet
+ * instead of a null packet.  The log and param helpers also send
+ * anything waiting on the queue before each of their own requests,
+ * so queued control packets are never stuck behind a batch.
+ * Without an attached queue, don't write to the same device through
+ * a tx queue: any downlink data in those acks would be lost.
+ */
+
+#define CRTP_RX_QUEUE            32
+#define CRTP_XFER_TIMEOUT        100
+#define CRTP_NULL_HEADER         0xFF
+#define CRTP_POLL_BURST          10
+#define CRTP_DEFAULT_POLL_MIN_US 1000
+#define CRTP_DEFAULT_POLL_MAX_US 10000
+#define CRTP_BATCH_WINDOW        8
+#define CRTP_RESPONSE_US         100000
+
+#define LOG_CMD_DELETE_BLOCK     0x02
+#define LOG_CMD_START_BLOCK      0x03
+#define LOG_CMD_STOP_BLOCK       0x04
+#define LOG_CMD_RESET            0x05
+#define LOG_CMD_CREATE_BLOCK_V2  0x06
+#define LOG_CMD_APPEND_BLOCK_V2  0x07
+
+struct cradio_crtp_link_t {
+    cradio_device_t *prd;
+    uint64_t poll_min_us;
+    uint64_t poll_max_us;
+    uint64_t poll_interval_us;
+    uint64_t next_poll_us;
+    int empty_streak;
+    int rx_head;
+    int rx_count;
+    cradio_crtp_packet_t rx[CRTP_RX_QUEUE];
+    cradio_crtp_stats_t stats;
+    cradio_txq_t *txq;
+};
+
+static void sleep_us(uint64_t us) {
+    struct timespec ts;
+
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    nanosleep(&ts, NULL);
+}
+
+static int is_cradio_error(int error_code) {
+    return (last_error_type == ERROR_TYPE_CRADIO) &&
+        (last_error == error_code);
+}
+
+static int is_noack(void) {
+    return is_cradio_error(CR_ERR_NOACK);
+}
+
+cradio_crtp_link_t *cradio_crtp_new(cradio_device_t *prd) {
+    cradio_crtp_link_t *pl;
+
+    pl = (cradio_crtp_link_t *)malloc(sizeof(cradio_crtp_link_t));
+    if(!pl)
+        cradio_exit("malloc error");
+    memset(pl, 0, sizeof(cradio_crtp_link_t));
+
+    pl->prd = prd;
+    pl->poll_min_us = CRTP_DEFAULT_POLL_MIN_US;
+    pl->poll_max_us = CRTP_DEFAULT_POLL_MAX_US;
+
+    CRDEBUG("Created crtp link");
+    return pl;
+}
+
+/* Free a link, detaching any attached tx queue.  The link and queue
+ * can be freed in either order.
+ */
+void cradio_crtp_free(cradio_crtp_link_t *pl) {
+    if(pl)
+        crtp_detach_txq(pl);
+    free(pl);
+}
+
+/* Set the bounds of the idle poll interval
+ *
+ * Once acks stop carrying data, null packets are spaced starting at
+ * min_us and doubling up to max_us.
+ */
+void cradio_crtp_set_poll_interval(cradio_crtp_link_t *pl,
+                                   int min_us, int max_us) {
+    pl->poll_min_us = 1;
+    if(min_us > 1)
+        pl->poll_min_us = (uint64_t)min_us;
+
+    pl->poll_max_us = pl->poll_min_us;
+    if((max_us > 0) && ((uint64_t)max_us > pl->poll_min_us))
+        pl->poll_max_us = (uint64_t)max_us;
+}
+
+void cradio_crtp_get_stats(cradio_crtp_link_t *pl,
+                           cradio_crtp_stats_t *stats) {
+    *stats = pl->stats;
+}
+
+static void crtp_rx_push(cradio_crtp_link_t *pl, unsigned char *buffer,
+                         int len) {
+    cradio_crtp_packet_t *pkt;
+
+    if(pl->rx_count == CRTP_RX_QUEUE) {
+        CRWARN("crtp rx queue full, dropping oldest packet");
+        pl->rx_head = (pl->rx_head + 1) % CRTP_RX_QUEUE;
+        pl->rx_count--;
+        pl->stats.dropped++;
+    }
+
+    if(len > CRTP_MAX_DATA + 1)
+        len = CRTP_MAX_DATA + 1;
+
+    pkt = &pl->rx[(pl->rx_head + pl->rx_count) % CRTP_RX_QUEUE];
+    pkt->port = buffer[0] >> 4;
+    pkt->channel = buffer[0] & 0x03;
+    pkt->len = len - 1;
+    memcpy(pkt->data, buffer + 1, pkt->len);
+
+    pl->rx_count++;
+    pl->stats.received++;
+}
+
+/* take the oldest queued packet on port/channel (-1 matches any),
+ * keeping the rest in order
+ */
+static int crtp_rx_take(cradio_crtp_link_t *pl, int port, int channel,
+                        cradio_crtp_packet_t *pkt) {
+    for(int idx = 0; idx < pl->rx_count; idx++) {
+        cradio_crtp_packet_t *pe =
+            &pl->rx[(pl->rx_head + idx) % CRTP_RX_QUEUE];
+
+        if(((port != -1) && (pe->port != port)) ||
+           ((channel != -1) && (pe->channel != channel)))
+            continue;
+
+        *pkt = *pe;
+
+        for(; idx > 0; idx--)
+            pl->rx[(pl->rx_head + idx) % CRTP_RX_QUEUE] =
+                pl->rx[(pl->rx_head + idx - 1) % CRTP_RX_QUEUE];
+
+        pl->rx_head = (pl->rx_head + 1) % CRTP_RX_QUEUE;
+        pl->rx_count--;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* adjust the idle poll interval after an ack with or without data */
+static void crtp_adapt(cradio_crtp_link_t *pl, int got_data) {
+    if(got_data) {
+        pl->empty_streak = 0;
+        pl->poll_interval_us = 0;
+    } else if(++pl->empty_streak > CRTP_POLL_BURST) {
+        pl->empty_streak = CRTP_POLL_BURST;
+        if(!pl->poll_interval_us)
+            pl->poll_interval_us = pl->poll_min_us;
+        else if(pl->poll_interval_us * 2 < pl->poll_max_us)
+            pl->poll_interval_us *= 2;
+        else
+            pl->poll_interval_us = pl->poll_max_us;
+    }
+
+    pl->next_poll_us = now_us() + pl->poll_interval_us;
+}
+
+/* queue the downlink data (if any) from an ack payload
+ *
+ * Returns 1 if it carried data, 0 if it was empty.
+ */
+static int crtp_ack_payload(cradio_crtp_link_t *pl, unsigned char *payload,
+                            int len) {
+    /* no payload, or a link layer null packet */
+    if((len < 1) || ((payload[0] & 0xF3) == 0xF3)) {
+        crtp_adapt(pl, 0);
+        return 0;
+    }
+
+    crtp_rx_push(pl, payload, len);
+    crtp_adapt(pl, 1);
+    return 1;
+}
+
+/* write a raw packet and collect its ack
+ *
+ * Returns 1 if the ack carried downlink data (now queued), 0 if it
+ * was empty, or -1 on error.
+ */
+static int crtp_exchange(cradio_crtp_link_t *pl, unsigned char *buffer,
+                         int len) {
+    unsigned char ack[64];
+    int rc;
+
+    rc = cradio_write_packet(pl->prd, buffer, len, CRTP_XFER_TIMEOUT);
+    if(rc < 0)
+        return -1;
+    if(rc != len)
+        return set_usb_error(LIBUSB_ERROR_TIMEOUT);
+
+    rc = cradio_read_packet(pl->prd, ack, sizeof(ack), CRTP_XFER_TIMEOUT);
+    if(rc < 0)
+        return -1;
+
+    if((rc < 1) || !(ack[0] & ACK_STATUS_ACK)) {
+        pl->stats.no_ack++;
+        return set_cradio_error(CR_ERR_NOACK);
+    }
+
+    return crtp_ack_payload(pl, ack + 1, rc - 1);
+}
+
+/* ack payloads of packets sent through an attached tx queue */
+static void crtp_txq_ack(int prio, unsigned char *payload, int len,
+                         void *arg) {
+    (void)prio;
+    crtp_ack_payload((cradio_crtp_link_t *)arg, payload, len);
+}
+
+/* build the on-air frame for a CRTP packet, returning its length */
+static int crtp_frame(cradio_crtp_packet_t *pkt, unsigned char *buffer) {
+    if((pkt->port > 0x0F) || (pkt->channel > 0x03) ||
+       (pkt->len < 0) || (pkt->len > CRTP_MAX_DATA))
+        return set_cradio_error(CR_ERR_BADCRTP);
+
+    buffer[0] = (pkt->port << 4) | 0x0C | pkt->channel;
+    memcpy(buffer + 1, pkt->data, pkt->len);
+    return pkt->len + 1;
+}
+
+/* Send a CRTP packet
+ *
+ * Any downlink data in the ack is queued for cradio_crtp_receive.
+ */
+int cradio_crtp_send(cradio_crtp_link_t *pl, cradio_crtp_packet_t *pkt) {
+    unsigned char buffer[CRTP_MAX_DATA + 1];
+    int len;
+
+    if((len = crtp_frame(pkt, buffer)) < 0)
+        return -1;
+
+    if(crtp_exchange(pl, buffer, len) < 0)
+        return -1;
+
+    pl->stats.sent++;
+    return 0;
+}
+
+/* Attach a tx queue on the same device to the link
+ *
+ * Ack payloads of everything the queue sends are collected by the
+ * link, and link polls dispatch from the queue before falling back
+ * to null packets.  Pass NULL to detach.  A queue can only be
+ * attached to one link at a time; freeing either side detaches it.
+ */
+void cradio_crtp_set_txq(cradio_crtp_link_t *pl, cradio_txq_t *pq) {
+    crtp_detach_txq(pl);
+
+    if(pq) {
+        if(pq->link)
+            crtp_detach_txq(pq->link);
+
+        pl->txq = pq;
+        pq->link = pl;
+        cradio_txq_set_ack_callback(pq, crtp_txq_ack, pl);
+    }
+}
+
+/* break the link <-> queue attachment from either side */
+static void crtp_detach_txq(cradio_crtp_link_t *pl) {
+    if(pl->txq) {
+        cradio_txq_set_ack_callback(pl->txq, NULL, NULL);
+        pl->txq->link = NULL;
+        pl->txq = NULL;
+    }
+}
+
+/* Queue a CRTP packet on the attached tx queue
+ *
+ * prio and deadline_ms are as for cradio_txq_push.  The packet goes
+ * out on the next dispatch or link poll.
+ */
+int cradio_crtp_queue(cradio_crtp_link_t *pl, int prio,
+                      cradio_crtp_packet_t *pkt, int deadline_ms) {
+    unsigned char buffer[CRTP_MAX_DATA + 1];
+    int len;
+
+    if(!pl->txq)
+        return set_cradio_error(CR_ERR_NOTXQ);
+
+    if((len = crtp_frame(pkt, buffer)) < 0)
+        return -1;
+
+    return cradio_txq_push(pl->txq, prio, buffer, len, deadline_ms);
+}
+
+/* dispatch the next packet from the attached queue, if any.
+ * Returns 1 if data came back, 0 if the ack was empty, -1 on error,
+ * or -2 if there was nothing to send.
+ */
+static int crtp_dispatch_txq(cradio_crtp_link_t *pl) {
+    uint32_t received = pl->stats.received;
+    int rc;
+
+    if(!pl->txq || !cradio_txq_pending(pl->txq))
+        return -2;
+
+    rc = cradio_txq_dispatch(pl->txq, CRTP_XFER_TIMEOUT);
+    if(rc < 0) {
+        if(is_noack())
+            pl->stats.no_ack++;
+        return -1;
+    }
+
+    /* everything pending had expired */
+    if(!rc)
+        return -2;
+
+    pl->stats.sent++;
+    return pl->stats.received != received;
+}
+
+/* send a request from the link's own log/param helpers, letting
+ * anything waiting on the attached tx queue go out first
+ */
+static int crtp_send_after_txq(cradio_crtp_link_t *pl,
+                               cradio_crtp_packet_t *pkt) {
+    int rc;
+
+    while((rc = crtp_dispatch_txq(pl)) != -2)
+        if((rc < 0) && !is_noack())
+            return -1;
+
+    return cradio_crtp_send(pl, pkt);
+}
+
+/* Pull downlink data
+ *
+ * Sends the next packet from the attached tx queue, or a null packet
+ * if there isn't one.  Returns 1 if data came back, 0 if the ack was
+ * empty, -1 on error.
+ */
+int cradio_crtp_poll(cradio_crtp_link_t *pl) {
+    unsigned char null_packet = CRTP_NULL_HEADER;
+    int rc;
+
+    if((rc = crtp_dispatch_txq(pl)) != -2)
+        return rc;
+
+    rc = crtp_exchange(pl, &null_packet, 1);
+    if(rc >= 0) {
+        pl->stats.polls++;
+        if(!rc)
+            pl->stats.empty_polls++;
+    }
+
+    return rc;
+}
+
+/* Receive the next downlink packet, polling as needed
+ *
+ * Waits up to timeout ms.  Returns 1 with a packet, 0 on timeout,
+ * or -1 on error.
+ */
+int cradio_crtp_receive(cradio_crtp_link_t *pl, cradio_crtp_packet_t *pkt,
+                        int timeout) {
+    uint64_t deadline = now_us() + (uint64_t)timeout * 1000;
+    uint64_t now;
+
+    while(1) {
+        if(crtp_rx_take(pl, -1, -1, pkt))
+            return 1;
+
+        now = now_us();
+        if(now >= deadline)
+            return 0;
+
+        if((pl->next_poll_us > now) &&
+           !(pl->txq && cradio_txq_pending(pl->txq)))
+            sleep_us((pl->next_poll_us < deadline ?
+                      pl->next_poll_us : deadline) - now);
+
+        if((cradio_crtp_poll(pl) < 0) && !is_noack())
+            return -1;
+    }
+}
+
+/* poll until a packet arrives on port/channel or the deadline passes.
+ * A response is expected, so there's no idle backoff here.
+ */
+static int crtp_wait_for(cradio_crtp_link_t *pl, int port, int channel,
+                         cradio_crtp_packet_t *pkt, uint64_t deadline) {
+    while(1) {
+        if(crtp_rx_take(pl, port, channel, pkt))
+            return 0;
+
+        if(now_us() >= deadline)
+            return set_cradio_error(CR_ERR_CRTPTIMEOUT);
+
+        if((cradio_crtp_poll(pl) < 0) && !is_noack())
+            return -1;
+    }
+}
+
+/* drop log control responses left over from earlier commands, so a
+ * late or duplicate one can't be taken as the reply to the next
+ */
+static void crtp_log_drain(cradio_crtp_link_t *pl) {
+    cradio_crtp_packet_t stale;
+
+    while(crtp_rx_take(pl, CRTP_PORT_LOG, CRTP_LOG_CH_CONTROL, &stale))
+        CRDEBUG("Dropping stale log response");
+}
+
+/* Send a log control command and wait for its matching response
+ *
+ * A missing radio ack doesn't mean the target missed the command,
+ * and without safelink it can't tell a resend from a new command.
+ * So after a missing ack we wait a while for the response before
+ * sending again, and only commands that are safe to run twice
+ * (resend set) are ever sent again.  For the rest a lost command is
+ * reported as a timeout.
+ */
+static int crtp_log_command(cradio_crtp_link_t *pl,
+                            cradio_crtp_packet_t *pkt, uint64_t deadline,
+                            int resend) {
+    cradio_crtp_packet_t resp;
+    uint8_t cmd = pkt->data[0];
+    uint8_t block_id = pkt->data[1];
+    uint64_t wait_until;
+    int acked;
+    int rc;
+
+    crtp_log_drain(pl);
+
+    while(1) {
+        rc = crtp_send_after_txq(pl, pkt);
+        if(rc && !is_noack())
+            return -1;
+        acked = !rc;
+
+        /* an acked command will be answered, so wait it out */
+        wait_until = now_us() + CRTP_RESPONSE_US;
+        if(acked || (wait_until > deadline))
+            wait_until = deadline;
+
+        do {
+            rc = crtp_wait_for(pl, CRTP_PORT_LOG, CRTP_LOG_CH_CONTROL,
+                               &resp, wait_until);
+        } while(!rc && ((resp.len < 3) || (resp.data[0] != cmd) ||
+                        (resp.data[1] != block_id)));
+
+        if(!rc)
+            break;
+
+        if(acked || !resend || (now_us() >= deadline))
+            return -1;
+
+        CRDEBUG("No response to log command %d, resending", cmd);
+    }
+
+    if(resp.data[2]) {
+        CRDEBUG("Log command %d failed with error %d", cmd, resp.data[2]);
+        return set_cradio_error(CR_ERR_TARGET);
+    }
+
+    return 0;
+}
+
+static void crtp_log_packet(cradio_crtp_packet_t *pkt, uint8_t cmd,
+                            uint8_t block_id) {
+    pkt->port = CRTP_PORT_LOG;
+    pkt->channel = CRTP_LOG_CH_CONTROL;
+    pkt->data[0] = cmd;
+    pkt->data[1] = block_id;
+    pkt->len = 2;
+}
+
+/* start, stop, delete and reset can all safely be run twice */
+static int crtp_log_simple(cradio_crtp_link_t *pl, uint8_t cmd,
+                           uint8_t block_id, int arg, uint64_t deadline) {
+    cradio_crtp_packet_t pkt;
+
+    crtp_log_packet(&pkt, cmd, block_id);
+    if(arg >= 0)
+        pkt.data[pkt.len++] = arg;
+
+    return crtp_log_command(pl, &pkt, deadline, 1);
+}
+
+/* best effort delete of a half-built block, keeping the error that
+ * caused it
+ */
+static void crtp_log_discard(cradio_crtp_link_t *pl, uint8_t block_id) {
+    int error = last_error;
+    int error_type = last_error_type;
+
+    crtp_log_simple(pl, LOG_CMD_DELETE_BLOCK, block_id, -1,
+                    now_us() + CRTP_RESPONSE_US);
+
+    last_error = error;
+    last_error_type = error_type;
+}
+
+static int log_type_size(uint8_t type) {
+    switch(type) {
+    case CRTP_LOG_UINT8:
+    case CRTP_LOG_INT8:
+        return 1;
+    case CRTP_LOG_UINT16:
+    case CRTP_LOG_INT16:
+    case CRTP_LOG_FP16:
+        return 2;
+    case CRTP_LOG_UINT32:
+    case CRTP_LOG_INT32:
+    case CRTP_LOG_FLOAT:
+        return 4;
+    }
+    return 0;
+}
+
+/* send the create and appends for a block, without resends: a
+ * duplicated append would silently corrupt the block layout
+ */
+static int crtp_log_build(cradio_crtp_link_t *pl, uint8_t block_id,
+                          cradio_crtp_log_var_t *vars, int count,
+                          uint64_t deadline, int *created) {
+    cradio_crtp_packet_t pkt;
+    uint8_t cmd = LOG_CMD_CREATE_BLOCK_V2;
+    int idx = 0;
+
+    while(idx < count) {
+        crtp_log_packet(&pkt, cmd, block_id);
+
+        while((idx < count) && (pkt.len + 3 <= CRTP_MAX_DATA)) {
+            pkt.data[pkt.len++] = vars[idx].type;
+            pkt.data[pkt.len++] = vars[idx].id & 0xFF;
+            pkt.data[pkt.len++] = vars[idx].id >> 8;
+            idx++;
+        }
+
+        if(crtp_log_command(pl, &pkt, deadline, 0))
+            return -1;
+
+        *created = 1;
+        cmd = LOG_CMD_APPEND_BLOCK_V2;
+    }
+
+    return 0;
+}
+
+/* Create a log block holding a set of variables
+ *
+ * Variables are packed as many to a packet as will fit: one create
+ * command, then appends for the remainder, rather than a round trip
+ * per variable.  The block's values must fit in 26 bytes.
+ *
+ * If a command may have been lost, the block is deleted and built
+ * again from scratch until the timeout, so a half-built block is
+ * never left on the target.
+ */
+int cradio_crtp_log_create_block(cradio_crtp_link_t *pl, uint8_t block_id,
+                                 cradio_crtp_log_var_t *vars, int count,
+                                 int timeout) {
+    uint64_t deadline = now_us() + (uint64_t)timeout * 1000;
+    int created;
+    int size = 0;
+    int idx = 0;
+
+    for(idx = 0; idx < count; idx++) {
+        int var_size = log_type_size(vars[idx].type);
+        if(!var_size)
+            return set_cradio_error(CR_ERR_BADLOGBLOCK);
+        size += var_size;
+    }
+
+    if((count < 1) || (size > CRTP_LOG_MAX_BLOCK_DATA))
+        return set_cradio_error(CR_ERR_BADLOGBLOCK);
+
+    CRDEBUG("Creating log block %d with %d variables", block_id, count);
+
+    while(1) {
+        created = 0;
+        if(!crtp_log_build(pl, block_id, vars, count, deadline, &created))
+            return 0;
+
+        /* the target refused something: clean up any block we made */
+        if(is_cradio_error(CR_ERR_TARGET)) {
+            if(created)
+                crtp_log_discard(pl, block_id);
+            return -1;
+        }
+
+        if(!is_noack() && !is_cradio_error(CR_ERR_CRTPTIMEOUT))
+            return -1;
+
+        /* we don't know how much of the block the target saw */
+        if(now_us() >= deadline) {
+            crtp_log_discard(pl, block_id);
+            return -1;
+        }
+
+        CRDEBUG("Lost a log command, rebuilding block %d", block_id);
+        if(crtp_log_simple(pl, LOG_CMD_DELETE_BLOCK, block_id, -1, deadline) &&
+           !is_cradio_error(CR_ERR_TARGET))
+            return -1;
+    }
+}
+
+/* Start streaming a log block every period_ms (10ms resolution) */
+int cradio_crtp_log_start(cradio_crtp_link_t *pl, uint8_t block_id,
+                          int period_ms, int timeout) {
+    if((period_ms < 10) || (period_ms > 2550))
+        return set_cradio_error(CR_ERR_BADLOGPERIOD);
+
+    return crtp_log_simple(pl, LOG_CMD_START_BLOCK, block_id,
+                           period_ms / 10,
+                           now_us() + (uint64_t)timeout * 1000);
+}
+
+int cradio_crtp_log_stop(cradio_crtp_link_t *pl, uint8_t block_id,
+                         int timeout) {
+    return crtp_log_simple(pl, LOG_CMD_STOP_BLOCK, block_id, -1,
+                           now_us() + (uint64_t)timeout * 1000);
+}
+
+int cradio_crtp_log_delete(cradio_crtp_link_t *pl, uint8_t block_id,
+                           int timeout) {
+    return crtp_log_simple(pl, LOG_CMD_DELETE_BLOCK, block_id, -1,
+                           now_us() + (uint64_t)timeout * 1000);
+}
+
+/* Delete all log blocks on the target */
+int cradio_crtp_log_reset(cradio_crtp_link_t *pl, int timeout) {
+    return crtp_log_simple(pl, LOG_CMD_RESET, 0, -1,
+                           now_us() + (uint64_t)timeout * 1000);
+}
+
+/* Split a log data packet into block id, timestamp (ms) and values
+ *
+ * Returns 1 if pkt is log data, 0 otherwise.
+ */
+int cradio_crtp_log_parse(cradio_crtp_packet_t *pkt, uint8_t *block_id,
+                          uint32_t *timestamp, unsigned char **data,
+                          int *len) {
+    if((pkt->port != CRTP_PORT_LOG) || (pkt->channel != CRTP_LOG_CH_DATA) ||
+       (pkt->len < 4))
+        return 0;
+
+    *block_id = pkt->data[0];
+    *timestamp = pkt->data[1] | (pkt->data[2] << 8) |
+        ((uint32_t)pkt->data[3] << 16);
+    *data = pkt->data + 4;
+    *len = pkt->len - 4;
+    return 1;
+}
+
+/* pipeline a set of param reads or writes
+ *
+ * Up to CRTP_BATCH_WINDOW requests are kept in flight, so responses
+ * ride back on the acks of later requests instead of each one
+ * costing its own null-packet round trips.  Requests still waiting
+ * after CRTP_RESPONSE_US are sent again (reads and writes of the
+ * same value are both safe to repeat), and duplicate responses are
+ * dropped.
+ *
+ * Returns the number of params left unanswered at the timeout.
+ */
+static int crtp_param_batch(cradio_crtp_link_t *pl, uint8_t channel,
+                            cradio_crtp_param_t *params, int count,
+                            int timeout) {
+    cradio_crtp_packet_t pkt;
+    uint64_t deadline = now_us() + (uint64_t)timeout * 1000;
+    uint64_t *sent_us;
+    uint64_t now;
+    int next = 0;
+    int in_flight = 0;
+    int done = 0;
+    int send;
+    int idx;
+    int rc = 0;
+
+    for(idx = 0; idx < count; idx++) {
+        if((channel == CRTP_PARAM_CH_WRITE) &&
+           ((params[idx].len < 1) ||
+            (params[idx].len > CRTP_PARAM_MAX_VALUE)))
+            return set_cradio_error(CR_ERR_BADCRTP);
+    }
+
+    for(idx = 0; idx < count; idx++)
+        params[idx].status = CRTP_PARAM_NO_RESPONSE;
+
+    if(count <= 0)
+        return 0;
+
+    sent_us = (uint64_t *)malloc(count * sizeof(uint64_t));
+    if(!sent_us)
+        cradio_exit("malloc error");
+
+    while(done < count) {
+        while(crtp_rx_take(pl, CRTP_PORT_PARAM, channel, &pkt)) {
+            uint16_t id;
+
+            if(pkt.len < 2)
+                continue;
+
+            id = pkt.data[0] | (pkt.data[1] << 8);
+            for(idx = 0; idx < next; idx++)
+                if((params[idx].status == CRTP_PARAM_NO_RESPONSE) &&
+                   (params[idx].id == id))
+                    break;
+
+            if(idx == next) {
+                CRDEBUG("Dropping unexpected response for param %d", id);
+                continue;
+            }
+
+            if(channel == CRTP_PARAM_CH_READ) {
+                if(pkt.len < 3)
+                    continue;
+                params[idx].status = pkt.data[2];
+                params[idx].len = pkt.len - 3;
+                if(params[idx].len > CRTP_PARAM_MAX_VALUE)
+                    params[idx].len = CRTP_PARAM_MAX_VALUE;
+                memcpy(params[idx].value, pkt.data + 3, params[idx].len);
+            } else {
+                params[idx].status = 0;
+            }
+
+            in_flight--;
+            done++;
+        }
+
+        if(done == count)
+            break;
+
+        now = now_us();
+        if(now >= deadline) {
+            CRDEBUG("%d of %d params unanswered", count - done, count);
+            break;
+        }
+
+        /* resend the oldest overdue request ahead of any new ones */
+        send = -1;
+        for(idx = 0; idx < next; idx++) {
+            if((params[idx].status == CRTP_PARAM_NO_RESPONSE) &&
+               (sent_us[idx] + CRTP_RESPONSE_US <= now) &&
+               ((send < 0) || (sent_us[idx] < sent_us[send])))
+                send = idx;
+        }
+
+        if((send < 0) && (next < count) && (in_flight < CRTP_BATCH_WINDOW))
+            send = next;
+
+        if(send >= 0) {
+            pkt.port = CRTP_PORT_PARAM;
+            pkt.channel = channel;
+            pkt.data[0] = params[send].id & 0xFF;
+            pkt.data[1] = params[send].id >> 8;
+            pkt.len = 2;
+
+            if(channel == CRTP_PARAM_CH_WRITE) {
+                memcpy(pkt.data + 2, params[send].value, params[send].len);
+                pkt.len += params[send].len;
+            }
+
+            if(send < next)
+                CRDEBUG("No response for param %d, resending",
+                        params[send].id);
+
+            rc = crtp_send_after_txq(pl, &pkt);
+            if(!rc) {
+                sent_us[send] = now_us();
+                if(send == next) {
+                    next++;
+                    in_flight++;
+                }
+            }
+        } else {
+            rc = cradio_crtp_poll(pl) < 0 ? -1 : 0;
+        }
+
+        if(rc && !is_noack())
+            break;
+        rc = 0;
+    }
+
+    free(sent_us);
+
+    if(rc)
+        return -1;
+
+    return count - done;
+}
+
+/* Read a batch of parameters by TOC id
+ *
+ * Each param's status is set to the target's result, or
+ * CRTP_PARAM_NO_RESPONSE if nothing came back before the timeout;
+ * values are returned raw, in target byte order.  Returns the number
+ * of params left unanswered, or -1 on error.
+ */
+int cradio_crtp_param_read(cradio_crtp_link_t *pl,
+                           cradio_crtp_param_t *params, int count,
+                           int timeout) {
+    CRDEBUG("Reading %d params", count);
+    return crtp_param_batch(pl, CRTP_PARAM_CH_READ, params, count, timeout);
+}
+
+/* Write a batch of parameters by TOC id, waiting for each to be
+ * confirmed by the target.  Returns the number of params left
+ * unconfirmed (status CRTP_PARAM_NO_RESPONSE), or -1 on error.
+ */
+int cradio_crtp_param_write(cradio_crtp_link_t *pl,
+                            cradio_crtp_param_t *params, int count,
+                            int timeout) {
+    CRDEBUG("Writing %d params", count);
+    return crtp_param_batch(pl, CRTP_PARAM_CH_WRITE, params, count, timeout);
+}
@@ -21,8 +21,13 @@
 #ifndef _CRAZYRADIO_H_
 #define _CRAZYRADIO_H_
 
+#include <stdarg.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* USB Vendor/Product IDs */
 #define CRADIO_VID 0x1915
 #define CRADIO_PID 0x7777
@@ -66,6 +71,108 @@ typedef struct cradio_device_t {
 
 typedef uint8_t *cradio_address;
 
+/* TX queue priority classes, highest first */
+#define TXQ_PRIO_CONTROL         0
+#define TXQ_PRIO_NORMAL          1
+#define TXQ_PRIO_BULK            2
+#define TXQ_PRIO_COUNT           3
+
+#define TXQ_MAX_PACKET           32
+
+typedef struct cradio_txq_t cradio_txq_t;
+
+typedef struct cradio_txq_stats_t {
+    int depth;                    /* packets currently queued */
+    int max_depth;                /* high water mark */
+    uint32_t queued;
+    uint32_t sent;
+    uint32_t expired;             /* dropped for missing their deadline */
+    uint32_t rejected;            /* refused because the class was full */
+    uint32_t failed;              /* usb errors or no ack from target */
+    uint64_t latency_total_us;    /* enqueue to ack from target */
+    uint32_t latency_max_us;
+} cradio_txq_stats_t;
+
+/* called for each packet dropped for missing its deadline; the
+ * packet is already off the queue, so it may be pushed again
+ */
+typedef void (*cradio_txq_expired_cb)(int prio, unsigned char *buffer,
+                                      int len, void *arg);
+
+/* called with the ack payload (len may be 0) of each packet the
+ * target acks
+ */
+typedef void (*cradio_txq_ack_cb)(int prio, unsigned char *payload,
+                                  int len, void *arg);
+
+/* CRTP (Crazy Real-Time Protocol) ports
+ * From https://wiki.bitcraze.io/projects:crazyflie:firmware:comm_protocol
+ */
+#define CRTP_PORT_CONSOLE        0x00
+#define CRTP_PORT_PARAM          0x02
+#define CRTP_PORT_COMMANDER      0x03
+#define CRTP_PORT_MEM            0x04
+#define CRTP_PORT_LOG            0x05
+#define CRTP_PORT_LOCALIZATION   0x06
+#define CRTP_PORT_GENERIC_SETPOINT 0x07
+#define CRTP_PORT_SETPOINT_HL    0x08
+#define CRTP_PORT_PLATFORM       0x0D
+#define CRTP_PORT_LINKCTRL       0x0F
+
+#define CRTP_LOG_CH_TOC          0x00
+#define CRTP_LOG_CH_CONTROL      0x01
+#define CRTP_LOG_CH_DATA         0x02
+
+#define CRTP_PARAM_CH_TOC        0x00
+#define CRTP_PARAM_CH_READ       0x01
+#define CRTP_PARAM_CH_WRITE      0x02
+#define CRTP_PARAM_CH_MISC       0x03
+
+#define CRTP_LOG_UINT8           0x01
+#define CRTP_LOG_UINT16          0x02
+#define CRTP_LOG_UINT32          0x03
+#define CRTP_LOG_INT8            0x04
+#define CRTP_LOG_INT16           0x05
+#define CRTP_LOG_INT32           0x06
+#define CRTP_LOG_FLOAT           0x07
+#define CRTP_LOG_FP16            0x08
+
+#define CRTP_MAX_DATA            30
+#define CRTP_LOG_MAX_BLOCK_DATA  26
+#define CRTP_PARAM_MAX_VALUE     8
+#define CRTP_PARAM_NO_RESPONSE   -1
+
+typedef struct cradio_crtp_link_t cradio_crtp_link_t;
+
+typedef struct cradio_crtp_packet_t {
+    uint8_t port;
+    uint8_t channel;
+    int len;
+    unsigned char data[CRTP_MAX_DATA];
+} cradio_crtp_packet_t;
+
+typedef struct cradio_crtp_stats_t {
+    uint32_t sent;                /* uplink packets carrying data */
+    uint32_t polls;               /* null packets sent to pull downlink */
+    uint32_t empty_polls;         /* polls that came back with nothing */
+    uint32_t received;            /* downlink packets from ack payloads */
+    uint32_t no_ack;
+    uint32_t dropped;             /* downlink lost to a full rx queue */
+} cradio_crtp_stats_t;
+
+typedef struct cradio_crtp_log_var_t {
+    uint16_t id;                  /* log TOC id */
+    uint8_t type;                 /* CRTP_LOG_* */
+} cradio_crtp_log_var_t;
+
+typedef struct cradio_crtp_param_t {
+    uint16_t id;                  /* param TOC id */
+    int status;                   /* 0 on success, target error, or
+                                     CRTP_PARAM_NO_RESPONSE */
+    int len;
+    unsigned char value[CRTP_PARAM_MAX_VALUE];
+} cradio_crtp_param_t;
+
 extern int cradio_init(void);
 extern cradio_device_t *cradio_get(int);
 extern int cradio_close(cradio_device_t *);
@@ -82,6 +189,9 @@ extern int cradio_set_arc(cradio_device_t *prd, uint16_t arc);
 extern int cradio_set_ard_time(cradio_device_t *prd, int us);
 extern int cradio_set_ard_bytes(cradio_device_t *prd, uint16_t bytes);
 extern int cradio_set_mode(cradio_device_t *prd, uint16_t mode);
+extern int cradio_set_ack_enable(cradio_device_t *prd, uint16_t enable_status);
+extern int cradio_set_config(cradio_device_t *prd, uint8_t request,
+                             uint16_t value);
 
 
 extern int cradio_read_packet(cradio_device_t *prd,
@@ -92,5 +202,62 @@ extern int cradio_write_packet(cradio_device_t *prd,
                                unsigned char *buffer,
                                int len, int timeout);
 
+extern cradio_txq_t *cradio_txq_new(cradio_device_t *prd, int depth);
+extern void cradio_txq_free(cradio_txq_t *pq);
+extern void cradio_txq_set_starvation_limit(cradio_txq_t *pq, int limit);
+extern void cradio_txq_set_expired_callback(cradio_txq_t *pq,
+                                            cradio_txq_expired_cb cb,
+                                            void *arg);
+extern void cradio_txq_set_ack_callback(cradio_txq_t *pq,
+                                        cradio_txq_ack_cb cb, void *arg);
+extern int cradio_txq_push(cradio_txq_t *pq, int prio,
+                           unsigned char *buffer, int len, int deadline_ms);
+extern int cradio_txq_dispatch(cradio_txq_t *pq, int timeout);
+extern int cradio_txq_flush(cradio_txq_t *pq, int timeout);
+extern int cradio_txq_pending(cradio_txq_t *pq);
+extern int cradio_txq_get_stats(cradio_txq_t *pq, int prio,
+                                cradio_txq_stats_t *stats);
+extern void cradio_txq_reset_stats(cradio_txq_t *pq);
+
+extern cradio_crtp_link_t *cradio_crtp_new(cradio_device_t *prd);
+extern void cradio_crtp_free(cradio_crtp_link_t *pl);
+extern void cradio_crtp_set_poll_interval(cradio_crtp_link_t *pl,
+                                          int min_us, int max_us);
+extern int cradio_crtp_send(cradio_crtp_link_t *pl,
+                            cradio_crtp_packet_t *pkt);
+extern void cradio_crtp_set_txq(cradio_crtp_link_t *pl, cradio_txq_t *pq);
+extern int cradio_crtp_queue(cradio_crtp_link_t *pl, int prio,
+                             cradio_crtp_packet_t *pkt, int deadline_ms);
+extern int cradio_crtp_poll(cradio_crtp_link_t *pl);
+extern int cradio_crtp_receive(cradio_crtp_link_t *pl,
+                               cradio_crtp_packet_t *pkt, int timeout);
+extern void cradio_crtp_get_stats(cradio_crtp_link_t *pl,
+                                  cradio_crtp_stats_t *stats);
+
+extern int cradio_crtp_log_create_block(cradio_crtp_link_t *pl,
+                                        uint8_t block_id,
+                                        cradio_crtp_log_var_t *vars,
+                                        int count, int timeout);
+extern int cradio_crtp_log_start(cradio_crtp_link_t *pl, uint8_t block_id,
+                                 int period_ms, int timeout);
+extern int cradio_crtp_log_stop(cradio_crtp_link_t *pl, uint8_t block_id,
+                                int timeout);
+extern int cradio_crtp_log_delete(cradio_crtp_link_t *pl, uint8_t block_id,
+                                  int timeout);
+extern int cradio_crtp_log_reset(cradio_crtp_link_t *pl, int timeout);
+extern int cradio_crtp_log_parse(cradio_crtp_packet_t *pkt,
+                                 uint8_t *block_id, uint32_t *timestamp,
+                                 unsigned char **data, int *len);
+
+extern int cradio_crtp_param_read(cradio_crtp_link_t *pl,
+                                  cradio_crtp_param_t *params,
+                                  int count, int timeout);
+extern int cradio_crtp_param_write(cradio_crtp_link_t *pl,
+                                   cradio_crtp_param_t *params,
+                                   int count, int timeout);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* _CRAZYRADIO_H_ */
@@ -0,0 +1,548 @@
+/*
+ * C++ wrapper for libcrazyradio
+ *
+ * Copyright (C) 2016 Ron Pedde (ron@pedde.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _CRAZYRADIO_HPP_
+#define _CRAZYRADIO_HPP_
+
+/* Header-only C++17 layer over crazyradio.h
+ *
+ * Radio settings are strongly typed values that can only be built
+ * through compile-time checked factories, so an out of range channel,
+ * retry count or retry delay is a compile error rather than a runtime
+ * CR_ERR_*.  A Profile groups a full radio configuration and can be a
+ * constexpr; applying it touches neither the heap nor the global
+ * error string unless the USB transfer itself fails.
+ *
+ * Errors from the C library are raised as cradio::Error, carrying the
+ * text from cradio_get_errorstr().
+ */
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include "crazyradio.h"
+
+namespace cradio {
+
+/* Raised whenever the underlying C call reports failure */
+class Error : public std::runtime_error {
+public:
+    explicit Error(const char *what) : std::runtime_error(what) {}
+};
+
+namespace detail {
+
+inline int check(int rc) {
+    if(rc < 0)
+        throw Error(cradio_get_errorstr());
+    return rc;
+}
+
+}  // namespace detail
+
+/* Radio channel, 0-126 (2400MHz - 2526MHz in 1MHz steps) */
+class Channel {
+public:
+    template <uint16_t N>
+    static constexpr Channel make() {
+        static_assert(N <= 126, "Invalid channel (must be 0-126)");
+        return Channel(N);
+    }
+
+    constexpr uint16_t value() const { return value_; }
+
+private:
+    explicit constexpr Channel(uint16_t value) : value_(value) {}
+    uint16_t value_;
+};
+
+enum class DataRate : uint16_t {
+    rate_250kbps = DATA_RATE_250KBPS,
+    rate_1mbps = DATA_RATE_1MBPS,
+    rate_2mbps = DATA_RATE_2MBPS
+};
+
+enum class Power : uint16_t {
+    m18dbm = POWER_M18DBM,
+    m12dbm = POWER_M12DBM,
+    m6dbm = POWER_M6DBM,
+    p0dbm = POWER_0DBM
+};
+
+enum class Mode : uint16_t {
+    ptx = MODE_PTX,
+    prx = MODE_PRX
+};
+
+/* ACK retry count (ARC), 0-15 */
+class RetryCount {
+public:
+    template <uint16_t N>
+    static constexpr RetryCount make() {
+        static_assert(N <= 15, "Invalid retry count (must be 0-15)");
+        return RetryCount(N);
+    }
+
+    constexpr uint16_t value() const { return value_; }
+
+private:
+    explicit constexpr RetryCount(uint16_t value) : value_(value) {}
+    uint16_t value_;
+};
+
+/* ACK retry delay (ARD)
+ *
+ * Either a fixed time or an ack payload length in bytes (see
+ * cradio_set_ard_bytes).  The nRF24 ARD register is 4 bits, giving
+ * delays of 250uS to 4000uS in 250uS steps, so the time form only
+ * accepts those exact values.  The register value is computed here
+ * and sent as-is by Device::set_ard.
+ */
+class RetryDelay {
+public:
+    template <int Us>
+    static constexpr RetryDelay time() {
+        static_assert((Us >= 250) && (Us <= 4000),
+                      "Invalid retry delay time (must be 250-4000)");
+        static_assert(Us % 250 == 0,
+                      "Invalid retry delay time (must be a multiple of 250)");
+        return RetryDelay(false, static_cast<uint16_t>(Us / 250 - 1));
+    }
+
+    template <uint16_t Bytes>
+    static constexpr RetryDelay bytes() {
+        static_assert(Bytes <= 32,
+                      "Invalid retry packet size (must be 0-32)");
+        return RetryDelay(true, static_cast<uint16_t>(Bytes | 0x80));
+    }
+
+    constexpr bool is_bytes() const { return is_bytes_; }
+
+    /* ARD register value */
+    constexpr uint16_t value() const { return value_; }
+
+private:
+    constexpr RetryDelay(bool is_bytes, uint16_t value)
+        : is_bytes_(is_bytes), value_(value) {}
+    bool is_bytes_;
+    uint16_t value_;
+};
+
+/* 5 byte radio address; default is 0xE7E7E7E7E7 */
+using Address = std::array<uint8_t, 5>;
+
+constexpr Address default_address = {{ 0xE7, 0xE7, 0xE7, 0xE7, 0xE7 }};
+
+/* A full radio configuration.  Every member is valid by construction,
+ * so a constexpr Profile is checked entirely at compile time.
+ */
+struct Profile {
+    Channel channel;
+    DataRate data_rate;
+    Power power;
+    RetryCount arc;
+    RetryDelay ard;
+    Mode mode;
+    Address address;
+};
+
+/* Fixed capacity, move-only packet buffer
+ *
+ * Storage is inline.  Sending takes the buffer by rvalue and a
+ * moved-from buffer is left empty, so a packet handed off to the
+ * radio can't be accidentally sent twice.
+ */
+template <std::size_t Capacity>
+class Buffer {
+public:
+    static constexpr std::size_t capacity = Capacity;
+
+    constexpr Buffer() noexcept : data_{}, size_(0) {}
+
+    template <std::size_t N>
+    explicit Buffer(const uint8_t (&bytes)[N]) noexcept : data_{}, size_(N) {
+        static_assert(N <= Capacity, "packet too large for buffer");
+        std::memcpy(data_.data(), bytes, N);
+    }
+
+    Buffer(const Buffer &) = delete;
+    Buffer &operator=(const Buffer &) = delete;
+
+    Buffer(Buffer &&other) noexcept : data_(other.data_), size_(other.size_) {
+        other.size_ = 0;
+    }
+
+    Buffer &operator=(Buffer &&other) noexcept {
+        if(this != &other) {
+            data_ = other.data_;
+            size_ = other.size_;
+            other.size_ = 0;
+        }
+        return *this;
+    }
+
+    void assign(const void *bytes, std::size_t len) {
+        if(len > Capacity)
+            throw std::length_error("packet too large for buffer");
+        std::memcpy(data_.data(), bytes, len);
+        size_ = len;
+    }
+
+    void resize(std::size_t len) {
+        if(len > Capacity)
+            throw std::length_error("packet too large for buffer");
+        size_ = len;
+    }
+
+    void clear() noexcept { size_ = 0; }
+
+    uint8_t *data() noexcept { return data_.data(); }
+    const uint8_t *data() const noexcept { return data_.data(); }
+    std::size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+
+    uint8_t &operator[](std::size_t idx) noexcept { return data_[idx]; }
+    uint8_t operator[](std::size_t idx) const noexcept { return data_[idx]; }
+
+    uint8_t *begin() noexcept { return data_.data(); }
+    uint8_t *end() noexcept { return data_.data() + size_; }
+    const uint8_t *begin() const noexcept { return data_.data(); }
+    const uint8_t *end() const noexcept { return data_.data() + size_; }
+
+private:
+    std::array<uint8_t, Capacity> data_;
+    std::size_t size_;
+};
+
+/* nRF24 payloads top out at 32 bytes; the dongle's bulk endpoints
+ * move up to 64 bytes per transfer.
+ */
+using Packet = Buffer<32>;
+using UsbPacket = Buffer<64>;
+
+/* Initialize the library; must be called once before Device::open */
+inline void init() {
+    if(cradio_init() != 0)
+        throw Error("could not initialize libusb");
+}
+
+/* RAII owner of a cradio_device_t */
+class Device {
+public:
+    /* Open the device_id'th crazyradio, or the first found if -1 */
+    static Device open(int device_id = -1) {
+        cradio_device_t *prd = cradio_get(device_id);
+        if(!prd)
+            throw Error(cradio_get_errorstr());
+        return Device(prd);
+    }
+
+    explicit Device(cradio_device_t *prd) noexcept : prd_(prd) {}
+
+    ~Device() {
+        if(prd_)
+            cradio_close(prd_);
+    }
+
+    Device(const Device &) = delete;
+    Device &operator=(const Device &) = delete;
+
+    Device(Device &&other) noexcept : prd_(other.prd_) {
+        other.prd_ = nullptr;
+    }
+
+    Device &operator=(Device &&other) noexcept {
+        if(this != &other) {
+            if(prd_)
+                cradio_close(prd_);
+            prd_ = other.prd_;
+            other.prd_ = nullptr;
+        }
+        return *this;
+    }
+
+    cradio_device_t *get() const noexcept { return prd_; }
+
+    float firmware() const noexcept { return prd_->firmware; }
+    const char *serial() const noexcept { return prd_->serial; }
+    const char *model() const noexcept { return prd_->model; }
+
+    /* The typed setters are valid by construction, so they skip the
+     * C library's range checks and send the values straight through.
+     */
+    void set_channel(Channel channel) {
+        set_config(CONF_SET_RADIO_CHANNEL, channel.value());
+    }
+
+    void set_data_rate(DataRate rate) {
+        set_config(CONF_SET_DATA_RATE, static_cast<uint16_t>(rate));
+    }
+
+    void set_power(Power power) {
+        set_config(CONF_SET_RADIO_POWER, static_cast<uint16_t>(power));
+    }
+
+    void set_arc(RetryCount arc) {
+        set_config(CONF_SET_RADIO_ARC, arc.value());
+    }
+
+    void set_ard(RetryDelay ard) {
+        set_config(CONF_SET_RADIO_ARD, ard.value());
+    }
+
+    void set_mode(Mode mode) {
+        set_config(CONF_SET_RADIO_MODE, static_cast<uint16_t>(mode));
+    }
+
+    void set_address(const Address &address) {
+        Address tmp = address;
+        detail::check(cradio_set_address(prd_, tmp.data()));
+    }
+
+    void set_ack_enable(bool enable) {
+        detail::check(cradio_set_ack_enable(
+            prd_, enable ? AUTO_ACK_ENABLED : AUTO_ACK_DISABLED));
+    }
+
+    /* Apply a full profile.  Data rate goes first, as a byte-based
+     * ARD is derived from it.
+     */
+    void apply(const Profile &profile) {
+        set_data_rate(profile.data_rate);
+        set_channel(profile.channel);
+        set_power(profile.power);
+        set_arc(profile.arc);
+        set_ard(profile.ard);
+        set_address(profile.address);
+        set_mode(profile.mode);
+    }
+
+    /* write a packet (only valid in PTX mode), returns bytes written.
+     * The packet is consumed: it is left empty whether or not the
+     * write succeeds.
+     */
+    template <std::size_t N>
+    std::size_t write(Buffer<N> &&packet, int timeout) {
+        Buffer<N> out(std::move(packet));
+        return static_cast<std::size_t>(detail::check(cradio_write_packet(
+            prd_, out.data(), static_cast<int>(out.size()), timeout)));
+    }
+
+    /* receive a packet (only valid in PRX mode).  The buffer is resized
+     * to what was received; 0 on timeout.
+     */
+    template <std::size_t N>
+    std::size_t read(Buffer<N> &packet, int timeout) {
+        int rc = detail::check(cradio_read_packet(
+            prd_, packet.data(), static_cast<int>(N), timeout));
+        packet.resize(static_cast<std::size_t>(rc));
+        return packet.size();
+    }
+
+private:
+    void set_config(uint8_t request, uint16_t value) {
+        detail::check(cradio_set_config(prd_, request, value));
+    }
+
+    cradio_device_t *prd_;
+};
+
+/* Priority classes for TxQueue, highest first */
+enum class Priority : int {
+    control = TXQ_PRIO_CONTROL,
+    normal = TXQ_PRIO_NORMAL,
+    bulk = TXQ_PRIO_BULK
+};
+
+/* RAII owner of a cradio_txq_t bound to a Device */
+class TxQueue {
+public:
+    TxQueue(Device &device, int depth)
+        : pq_(cradio_txq_new(device.get(), depth)) {}
+
+    ~TxQueue() { cradio_txq_free(pq_); }
+
+    TxQueue(const TxQueue &) = delete;
+    TxQueue &operator=(const TxQueue &) = delete;
+
+    TxQueue(TxQueue &&other) noexcept : pq_(other.pq_) {
+        other.pq_ = nullptr;
+    }
+
+    TxQueue &operator=(TxQueue &&other) noexcept {
+        if(this != &other) {
+            cradio_txq_free(pq_);
+            pq_ = other.pq_;
+            other.pq_ = nullptr;
+        }
+        return *this;
+    }
+
+    cradio_txq_t *get() const noexcept { return pq_; }
+
+    void set_starvation_limit(int limit) {
+        cradio_txq_set_starvation_limit(pq_, limit);
+    }
+
+    void set_expired_callback(cradio_txq_expired_cb cb, void *arg) {
+        cradio_txq_set_expired_callback(pq_, cb, arg);
+    }
+
+    /* deadline_ms is relative to now; 0 never expires.  The packet
+     * is consumed, as with Device::write.
+     */
+    template <std::size_t N>
+    void push(Priority prio, Buffer<N> &&packet, int deadline_ms = 0) {
+        Buffer<N> out(std::move(packet));
+        detail::check(cradio_txq_push(pq_, static_cast<int>(prio),
+                                      out.data(),
+                                      static_cast<int>(out.size()),
+                                      deadline_ms));
+    }
+
+    /* true if a packet was sent, false if nothing was pending */
+    bool dispatch(int timeout) {
+        return detail::check(cradio_txq_dispatch(pq_, timeout)) > 0;
+    }
+
+    int flush(int timeout) {
+        return detail::check(cradio_txq_flush(pq_, timeout));
+    }
+
+    int pending() const { return cradio_txq_pending(pq_); }
+
+    cradio_txq_stats_t stats(Priority prio) const {
+        cradio_txq_stats_t stats;
+        detail::check(cradio_txq_get_stats(pq_, static_cast<int>(prio),
+                                           &stats));
+        return stats;
+    }
+
+    void reset_stats() { cradio_txq_reset_stats(pq_); }
+
+private:
+    cradio_txq_t *pq_;
+};
+
+/* RAII owner of a cradio_crtp_link_t bound to a Device */
+class CrtpLink {
+public:
+    explicit CrtpLink(Device &device) : pl_(cradio_crtp_new(device.get())) {}
+
+    ~CrtpLink() { cradio_crtp_free(pl_); }
+
+    CrtpLink(const CrtpLink &) = delete;
+    CrtpLink &operator=(const CrtpLink &) = delete;
+
+    CrtpLink(CrtpLink &&other) noexcept : pl_(other.pl_) {
+        other.pl_ = nullptr;
+    }
+
+    CrtpLink &operator=(CrtpLink &&other) noexcept {
+        if(this != &other) {
+            cradio_crtp_free(pl_);
+            pl_ = other.pl_;
+            other.pl_ = nullptr;
+        }
+        return *this;
+    }
+
+    cradio_crtp_link_t *get() const noexcept { return pl_; }
+
+    void set_poll_interval(int min_us, int max_us) {
+        cradio_crtp_set_poll_interval(pl_, min_us, max_us);
+    }
+
+    void send(cradio_crtp_packet_t &pkt) {
+        detail::check(cradio_crtp_send(pl_, &pkt));
+    }
+
+    /* share the device with a TxQueue; see cradio_crtp_set_txq */
+    void set_txq(TxQueue &queue) { cradio_crtp_set_txq(pl_, queue.get()); }
+
+    void queue(Priority prio, cradio_crtp_packet_t &pkt, int deadline_ms = 0) {
+        detail::check(cradio_crtp_queue(pl_, static_cast<int>(prio), &pkt,
+                                        deadline_ms));
+    }
+
+    /* true if downlink data came back */
+    bool poll() { return detail::check(cradio_crtp_poll(pl_)) > 0; }
+
+    /* false on timeout */
+    bool receive(cradio_crtp_packet_t &pkt, int timeout) {
+        return detail::check(cradio_crtp_receive(pl_, &pkt, timeout)) > 0;
+    }
+
+    cradio_crtp_stats_t stats() const {
+        cradio_crtp_stats_t stats;
+        cradio_crtp_get_stats(pl_, &stats);
+        return stats;
+    }
+
+    template <std::size_t N>
+    void log_create_block(uint8_t block_id,
+                          std::array<cradio_crtp_log_var_t, N> &vars,
+                          int timeout) {
+        detail::check(cradio_crtp_log_create_block(
+            pl_, block_id, vars.data(), static_cast<int>(N), timeout));
+    }
+
+    void log_start(uint8_t block_id, int period_ms, int timeout) {
+        detail::check(cradio_crtp_log_start(pl_, block_id, period_ms,
+                                            timeout));
+    }
+
+    void log_stop(uint8_t block_id, int timeout) {
+        detail::check(cradio_crtp_log_stop(pl_, block_id, timeout));
+    }
+
+    void log_delete(uint8_t block_id, int timeout) {
+        detail::check(cradio_crtp_log_delete(pl_, block_id, timeout));
+    }
+
+    void log_reset(int timeout) {
+        detail::check(cradio_crtp_log_reset(pl_, timeout));
+    }
+
+    /* returns the number of params left unanswered */
+    template <std::size_t N>
+    int param_read(std::array<cradio_crtp_param_t, N> &params, int timeout) {
+        return detail::check(cradio_crtp_param_read(
+            pl_, params.data(), static_cast<int>(N), timeout));
+    }
+
+    template <std::size_t N>
+    int param_write(std::array<cradio_crtp_param_t, N> &params,
+                    int timeout) {
+        return detail::check(cradio_crtp_param_write(
+            pl_, params.data(), static_cast<int>(N), timeout));
+    }
+
+private:
+    cradio_crtp_link_t *pl_;
+};
+
+}  // namespace cradio
+
+#endif /* _CRAZYRADIO_HPP_ */
@@ -0,0 +1,181 @@
+/*
+ * Example crazyflie telemetry program
+ *
+ * Copyright (C) 2016 Ron Pedde (ron@pedde.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * usage: crtp-test [radio id] [log var id ...]
+ *
+ * Reads a batch of params, streams the given (float) log variables
+ * and sends zero-thrust setpoints through a tx queue at control
+ * priority, then prints link and queue stats.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "crazyradio.h"
+
+#include "config.h"
+
+#define LOG_BLOCK_ID  1
+#define PARAM_COUNT   8
+#define RUN_TIME      10
+#define TIMEOUT       1000
+
+int main(int argc, char *argv[]) {
+    cradio_device_t *dev;
+    cradio_txq_t *pq;
+    cradio_crtp_link_t *pl;
+    cradio_crtp_packet_t pkt;
+    cradio_crtp_packet_t setpoint;
+    cradio_crtp_param_t params[PARAM_COUNT];
+    cradio_crtp_log_var_t vars[CRTP_LOG_MAX_BLOCK_DATA / 4];
+    cradio_crtp_stats_t link_stats;
+    cradio_txq_stats_t txq_stats;
+    time_t end_time;
+    int var_count = 0;
+    int radio_id = -1;
+    int rc;
+
+    if(argc > 1) {
+        radio_id = atoi(argv[1]);
+    }
+
+    for(int idx = 2; (idx < argc) && (var_count < CRTP_LOG_MAX_BLOCK_DATA / 4);
+        idx++) {
+        vars[var_count].id = atoi(argv[idx]);
+        vars[var_count].type = CRTP_LOG_FLOAT;
+        var_count++;
+    }
+
+    fprintf(stderr, "crtp-test: version %s\n", VERSION);
+
+    cradio_init();
+    dev = cradio_get(radio_id);
+
+    if(!dev) {
+        fprintf(stderr, "could not open device: %s\n", cradio_get_errorstr());
+        exit(EXIT_FAILURE);
+    }
+
+    printf("Found device: %s\n", dev->model);
+    printf("Serial: %s\n", dev->serial);
+    printf("Firmware Version: %g\n", dev->firmware);
+
+    /* crazyflie defaults: radio://0/80/2M */
+    if(cradio_set_channel(dev, 80) ||
+       cradio_set_data_rate(dev, DATA_RATE_2MBPS) ||
+       cradio_set_arc(dev, 3) ||
+       cradio_set_mode(dev, MODE_PTX)) {
+        fprintf(stderr, "error setting up radio: %s\n", cradio_get_errorstr());
+        exit(EXIT_FAILURE);
+    }
+
+    pq = cradio_txq_new(dev, 16);
+    pl = cradio_crtp_new(dev);
+    cradio_crtp_set_txq(pl, pq);
+
+    for(int idx = 0; idx < PARAM_COUNT; idx++)
+        params[idx].id = idx;
+
+    rc = cradio_crtp_param_read(pl, params, PARAM_COUNT, TIMEOUT);
+    if(rc < 0) {
+        fprintf(stderr, "error reading params: %s\n", cradio_get_errorstr());
+        exit(EXIT_FAILURE);
+    }
+
+    if(rc)
+        fprintf(stderr, "%d params got no response\n", rc);
+
+    for(int idx = 0; idx < PARAM_COUNT; idx++) {
+        printf("param %d: status %d, %d bytes:", params[idx].id,
+               params[idx].status, params[idx].len);
+        for(int byte = 0; byte < params[idx].len; byte++)
+            printf(" %02x", params[idx].value[byte]);
+        printf("\n");
+    }
+
+    if(var_count) {
+        if(cradio_crtp_log_reset(pl, TIMEOUT) ||
+           cradio_crtp_log_create_block(pl, LOG_BLOCK_ID, vars, var_count,
+                                        TIMEOUT) ||
+           cradio_crtp_log_start(pl, LOG_BLOCK_ID, 100, TIMEOUT)) {
+            fprintf(stderr, "error setting up logging: %s\n",
+                    cradio_get_errorstr());
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* roll, pitch, yaw (float) and thrust (uint16), all zero */
+    memset(&setpoint, 0, sizeof(setpoint));
+    setpoint.port = CRTP_PORT_COMMANDER;
+    setpoint.channel = 0;
+    setpoint.len = 14;
+
+    end_time = time(NULL) + RUN_TIME;
+
+    while(time(NULL) < end_time) {
+        uint8_t block_id;
+        uint32_t timestamp;
+        unsigned char *data;
+        int len;
+
+        if(!cradio_txq_pending(pq) &&
+           cradio_crtp_queue(pl, TXQ_PRIO_CONTROL, &setpoint, 20))
+            fprintf(stderr, "error queueing: %s\n", cradio_get_errorstr());
+
+        rc = cradio_crtp_receive(pl, &pkt, 10);
+        if(rc < 0)
+            fprintf(stderr, "error receiving: %s\n", cradio_get_errorstr());
+        if(rc <= 0)
+            continue;
+
+        if(cradio_crtp_log_parse(&pkt, &block_id, &timestamp, &data, &len)) {
+            printf("log block %d @ %ums:", block_id, timestamp);
+            for(int idx = 0; idx + 4 <= len; idx += 4) {
+                float value;
+                memcpy(&value, data + idx, sizeof(value));
+                printf(" %g", value);
+            }
+            printf("\n");
+        }
+    }
+
+    if(var_count)
+        cradio_crtp_log_stop(pl, LOG_BLOCK_ID, TIMEOUT);
+
+    cradio_crtp_get_stats(pl, &link_stats);
+    printf("link: sent %u polls %u empty %u received %u no ack %u "
+           "dropped %u\n", link_stats.sent, link_stats.polls,
+           link_stats.empty_polls, link_stats.received, link_stats.no_ack,
+           link_stats.dropped);
+
+    cradio_txq_get_stats(pq, TXQ_PRIO_CONTROL, &txq_stats);
+    printf("control: sent %u expired %u failed %u latency max %uus\n",
+           txq_stats.sent, txq_stats.expired, txq_stats.failed,
+           txq_stats.latency_max_us);
+
+    cradio_crtp_free(pl);
+    cradio_txq_free(pq);
+    cradio_close(dev);
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * Example C++ transmitter program
+ *
+ * Copyright (C) 2016 Ron Pedde (ron@pedde.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include "crazyradio.hpp"
+
+#include "config.h"
+
+/* Same radio setup as tx-test, checked at compile time */
+constexpr cradio::Profile profile{
+    cradio::Channel::make<100>(),
+    cradio::DataRate::rate_250kbps,
+    cradio::Power::p0dbm,
+    cradio::RetryCount::make<3>(),
+    cradio::RetryDelay::time<500>(),
+    cradio::Mode::ptx,
+    cradio::default_address
+};
+
+static_assert(profile.channel.value() == 100, "bad channel");
+static_assert(profile.ard.value() == 1, "500uS should be ARD register 1");
+
+int main(int argc, char *argv[]) {
+    int radio_id = -1;
+
+    if(argc > 1) {
+        radio_id = atoi(argv[1]);
+    }
+
+    fprintf(stderr, "cxx-test: version %s\n", VERSION);
+
+    try {
+        cradio::init();
+        cradio::Device dev = cradio::Device::open(radio_id);
+
+        printf("Found device: %s\n", dev.model());
+        printf("Serial: %s\n", dev.serial());
+        printf("Firmware Version: %g\n", dev.firmware());
+
+        dev.apply(profile);
+
+        cradio::Packet hello;
+        hello.assign("hello", 6);
+        dev.write(std::move(hello), 1000);
+
+        cradio::TxQueue queue(dev, 8);
+        int count = 0;
+
+        while(1) {
+            char text[cradio::Packet::capacity];
+            cradio::Packet packet;
+
+            snprintf(text, sizeof(text), "test packet %d", count++);
+            packet.assign(text, strlen(text) + 1);
+
+            printf("Sending packet...\n");
+            queue.push(cradio::Priority::control, std::move(packet), 1000);
+            queue.flush(1000);
+
+            cradio_txq_stats_t stats = queue.stats(cradio::Priority::control);
+            printf("Wrote packet: %s (latency max %uus)\n", text,
+                   stats.latency_max_us);
+            sleep(5);
+        }
+    } catch(const cradio::Error &e) {
+        fprintf(stderr, "radio error: %s\n", e.what());
+        exit(EXIT_FAILURE);
+    }
+}
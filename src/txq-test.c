@@ -0,0 +1,127 @@
+/*
+ * Example prioritized transmitter program
+ *
+ * Copyright (C) 2016 Ron Pedde (ron@pedde.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "crazyradio.h"
+
+#include "config.h"
+
+#define BULK_BURST   20
+#define NORMAL_BURST 5
+
+static const char *prio_names[TXQ_PRIO_COUNT] = {
+    "control",
+    "normal",
+    "bulk"
+};
+
+void print_expired(int prio, unsigned char *buffer, int len, void *arg) {
+    (void)arg;
+    printf("Expired %s packet (%d bytes): %s\n", prio_names[prio], len,
+           buffer);
+}
+
+void print_stats(cradio_txq_t *pq) {
+    cradio_txq_stats_t stats;
+
+    for(int prio = 0; prio < TXQ_PRIO_COUNT; prio++) {
+        cradio_txq_get_stats(pq, prio, &stats);
+        printf("%-8s depth %d/%d queued %u sent %u expired %u "
+               "rejected %u failed %u latency avg %uus max %uus\n",
+               prio_names[prio], stats.depth, stats.max_depth,
+               stats.queued, stats.sent, stats.expired, stats.rejected,
+               stats.failed,
+               stats.sent ? (uint32_t)(stats.latency_total_us / stats.sent) : 0,
+               stats.latency_max_us);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    cradio_device_t *dev;
+    cradio_txq_t *pq;
+    char buffer[TXQ_MAX_PACKET];
+    int radio_id = -1;
+
+    if(argc > 1) {
+        radio_id = atoi(argv[1]);
+    }
+
+    fprintf(stderr, "txq-test: version %s\n", VERSION);
+
+    cradio_init();
+    dev = cradio_get(radio_id);
+
+    if(!dev) {
+        fprintf(stderr, "could not open device: %s\n", cradio_get_errorstr());
+        exit(EXIT_FAILURE);
+    }
+
+    printf("Found device: %s\n", dev->model);
+    printf("Serial: %s\n", dev->serial);
+    printf("Firmware Version: %g\n", dev->firmware);
+
+    if(cradio_set_channel(dev, 100) ||
+       cradio_set_data_rate(dev, DATA_RATE_250KBPS) ||
+       cradio_set_mode(dev, MODE_PTX)) {
+        fprintf(stderr, "error setting up radio: %s\n", cradio_get_errorstr());
+        exit(EXIT_FAILURE);
+    }
+
+    pq = cradio_txq_new(dev, 32);
+    cradio_txq_set_expired_callback(pq, print_expired, NULL);
+
+    int count = 0;
+
+    while(1) {
+        /* a burst of bulk traffic, with a control packet queued last
+         * that should still go out first
+         */
+        for(int idx = 0; idx < BULK_BURST; idx++) {
+            snprintf(buffer, sizeof(buffer), "bulk %d", count++);
+            cradio_txq_push(pq, TXQ_PRIO_BULK, (unsigned char *)buffer,
+                            strlen(buffer) + 1, 0);
+        }
+
+        for(int idx = 0; idx < NORMAL_BURST; idx++) {
+            snprintf(buffer, sizeof(buffer), "normal %d", count++);
+            cradio_txq_push(pq, TXQ_PRIO_NORMAL, (unsigned char *)buffer,
+                            strlen(buffer) + 1, 500);
+        }
+
+        snprintf(buffer, sizeof(buffer), "control %d", count++);
+        if(cradio_txq_push(pq, TXQ_PRIO_CONTROL, (unsigned char *)buffer,
+                           strlen(buffer) + 1, 20)) {
+            fprintf(stderr, "error queueing: %s\n", cradio_get_errorstr());
+            exit(EXIT_FAILURE);
+        }
+
+        while(cradio_txq_pending(pq)) {
+            if(cradio_txq_dispatch(pq, 100) < 0)
+                fprintf(stderr, "error writing: %s\n", cradio_get_errorstr());
+        }
+
+        print_stats(pq);
+        sleep(5);
+    }
+}